@@ -42,8 +42,10 @@ WiFiServer server(80);
 // Function Prototypes
 void handleRoot(WiFiClient &client);
 void handleCaptureImages(WiFiClient &client, int delaySeconds);
+void handleCaptureFrame(WiFiClient &client);
 void handleGetAnalysis(WiFiClient &client, String promptType);
 void handleResetData(WiFiClient &client);
+void flushCameraBuffer();
 String captureImage();
 String sendToAPI(String prompt_text, String img1, String img2);
 String urlDecode(String input); // Helper for URL decoding
@@ -148,6 +150,8 @@ void loop() {
                 if (delaySeconds > 60) delaySeconds = 60;
               }
               handleCaptureImages(client, delaySeconds);
+            } else if (url == "/capture_frame") {
+              handleCaptureFrame(client);
             } else if (url.startsWith("/get_analysis")) {
               String promptType = "";
               int typePos = url.indexOf("type=");
@@ -483,6 +487,30 @@ void handleCaptureImages(WiFiClient &client, int delaySeconds) {
   client.println("\"}");
 }
 
+// Sends a single fresh frame as raw JPEG (used by the multi-camera gateway).
+// Unlike /capture_images this neither blocks for a delay nor keeps Base64 copies in RAM.
+void handleCaptureFrame(WiFiClient &client) {
+  Serial.println("Received /capture_frame request.");
+  flushCameraBuffer(); // Drop the stale frame so the gateway gets a current one
+  camera_fb_t * fb = esp_camera_fb_get();
+  if (!fb) {
+    Serial.println("Camera capture failed");
+    client.println("HTTP/1.1 503 Service Unavailable");
+    client.println("Content-Type: text/plain");
+    client.println();
+    client.println("Error: Camera capture failed.");
+    return;
+  }
+
+  client.println("HTTP/1.1 200 OK");
+  client.println("Content-Type: image/jpeg");
+  client.println("Content-Length: " + String(fb->len));
+  client.println("Connection: close");
+  client.println();
+  client.write(fb->buf, fb->len); // Stream the frame buffer directly, no Base64 expansion
+  esp_camera_fb_return(fb);
+}
+
 // Handles AI analysis requests for a specific prompt type
 void handleGetAnalysis(WiFiClient &client, String promptType) {
   Serial.println("Received /get_analysis request for type: " + promptType);
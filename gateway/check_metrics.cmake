@@ -0,0 +1,68 @@
+# Runs the gateway with GATEWAY_ARGS and checks the metrics it prints on exit against
+# EXPECT, a list of "<lhs><op><rhs>" with op "=" or ">". Each side is a number, a
+# top-level metric (upstream_errors), a per-camera metric summed over one prompt type
+# (alert.analyses), or, on the left only, a per-camera metric every camera must satisfy
+# (each.analyses>0).
+#
+#   cmake -DGATEWAY=<path> "-DGATEWAY_ARGS=--simulate;6;..." "-DEXPECT=analyses>0;..." -P check_metrics.cmake
+
+execute_process(COMMAND "${GATEWAY}" ${GATEWAY_ARGS}
+                OUTPUT_VARIABLE metrics
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "gateway exited with ${result}")
+endif()
+message(STATUS "${metrics}")
+
+string(JSON cameras LENGTH "${metrics}" per_camera)
+math(EXPR last "${cameras} - 1")
+
+# Resolves a number, metric or <type>.<metric> sum into out_var
+function(resolve term out_var)
+  if(term MATCHES "^[0-9]+$")
+    set(${out_var} ${term} PARENT_SCOPE)
+  elseif(term MATCHES "^([a-z]+)\\.([a-z_]+)$")
+    set(type ${CMAKE_MATCH_1})
+    set(key ${CMAKE_MATCH_2})
+    set(sum 0)
+    foreach(i RANGE ${last})
+      string(JSON camera_type GET "${metrics}" per_camera ${i} type)
+      if(camera_type STREQUAL type)
+        string(JSON value GET "${metrics}" per_camera ${i} ${key})
+        math(EXPR sum "${sum} + ${value}")
+      endif()
+    endforeach()
+    set(${out_var} ${sum} PARENT_SCOPE)
+  else()
+    string(JSON value GET "${metrics}" ${term})
+    set(${out_var} ${value} PARENT_SCOPE)
+  endif()
+endfunction()
+
+function(compare lhs_value op rhs_value label)
+  if(op STREQUAL "=" AND NOT lhs_value EQUAL rhs_value)
+    message(FATAL_ERROR "${label}: expected ${rhs_value}, got ${lhs_value}")
+  elseif(op STREQUAL ">" AND NOT lhs_value GREATER rhs_value)
+    message(FATAL_ERROR "${label}: expected more than ${rhs_value}, got ${lhs_value}")
+  endif()
+endfunction()
+
+foreach(check IN LISTS EXPECT)
+  if(NOT check MATCHES "^([a-z_.]+)([=>])([a-z_.0-9]+)$")
+    message(FATAL_ERROR "Malformed expectation '${check}'")
+  endif()
+  set(lhs ${CMAKE_MATCH_1})
+  set(op ${CMAKE_MATCH_2})
+  resolve(${CMAKE_MATCH_3} rhs_value)
+  if(lhs MATCHES "^each\\.([a-z_]+)$")
+    set(key ${CMAKE_MATCH_1})
+    foreach(i RANGE ${last})
+      string(JSON value GET "${metrics}" per_camera ${i} ${key})
+      string(JSON type GET "${metrics}" per_camera ${i} type)
+      compare(${value} ${op} ${rhs_value} "${check} (camera ${i}, ${type})")
+    endforeach()
+  else()
+    resolve(${lhs} lhs_value)
+    compare(${lhs_value} ${op} ${rhs_value} "${check}")
+  endif()
+endforeach()
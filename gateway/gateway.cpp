@@ -0,0 +1,1184 @@
+// ESP32-CAM multi-camera gateway (Linux)
+//
+// Polls many ESP32-CAM nodes, drops unchanged frames, schedules analyses fairly
+// across cameras and sends them upstream over a fixed pool of keep-alive
+// connections. Aggregated metrics are served on /metrics, latest results on /analyses.
+//
+// Build:  cmake -S . -B build && cmake --build build   (tests: ctest --test-dir build)
+//         or g++ -std=c++17 -O2 -pthread gateway.cpp -o gateway
+//         https:// upstreams (e.g. Avalapis) need -DGATEWAY_TLS=ON with CMake,
+//         or -DGATEWAY_TLS -lssl -lcrypto with g++
+//
+// Try it without hardware (simulated cameras + local mock LLM):
+//         ./gateway --simulate 12 --mock-llm 18080 --poll-ms 1000 --duration 30
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef GATEWAY_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+// Prompt texts, kept identical to the ones used on the device (Source_code.c)
+const std::string base_analysis_prompt = " Please analyze and describe:\n- Any noticeable changes in objects or lighting.\n- If any devices appear to have turned ON or OFF.\n- Any signs of human or animal presence or movement.\n- Any suspicious or unexpected changes.\nPlease respond with a clear and concise summary.";
+const std::string system_prompt = "You are an AI monitoring assistant. Compare two images and respond with a clear sentence describing any differences. Adhere strictly to the requested tone and detail level.";
+
+// ============ Configuration ============
+struct Config {
+  std::vector<std::string> cameras;   // "url[,type]" as given on the command line
+  std::string mode = "frame";          // "frame" -> /capture_frame, "json" -> /capture_images
+  int pollMs = 5000;
+  int captureDelay = 1;                // seconds, json mode only
+  std::string upstream = "https://api.avalapis.ir/v1/chat/completions";
+  std::string apiKey;
+  std::string model = "gemini-1.5-flash";
+  int connections = 4;                 // upstream pool size == max requests in flight
+  int dedupPercent = 0;                // JPEG size change below this counts as unchanged (opt-in)
+  int maxSkipMs = 60000;               // analyse anyway after this long without an analysis
+  int listenPort = 8080;
+  int simulate = 0;
+  int simBasePort = 18100;
+  int mockLlmPort = 0;
+  int mockLatencyMs = 300;
+  std::string mockFail;                // "500", "429" or "close": fault injected by the mock LLM
+  int mockFailEvery = 3;
+  int durationSec = 0;                 // 0 = run until interrupted
+};
+
+Config g_config;
+std::atomic<bool> g_running{true};
+const Clock::time_point g_startTime = Clock::now();
+
+double msBetween(Clock::time_point from, Clock::time_point to) {
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// ============ Helper Functions ============
+
+// Cheap "has the scene changed?" test without decoding the JPEGs. Sensor noise and
+// re-encoding change the bytes of every capture, so exact comparison only catches frames
+// the device repeats. With dedupPercent > 0 a JPEG size change below that percentage is
+// also treated as noise. That is a heuristic which can miss a change that keeps the size
+// (a person entering a large scene), so it is opt-in and bounded by --max-skip-ms.
+bool framesSimilar(const std::string &a, const std::string &b, int dedupPercent) {
+  if (a == b) return true;
+  if (dedupPercent <= 0) return false;
+  double larger = (double)std::max(a.size(), b.size());
+  double diff = a.size() > b.size() ? a.size() - b.size() : b.size() - a.size();
+  return diff * 100.0 < dedupPercent * larger;
+}
+
+std::string base64Encode(const std::string &in) {
+  static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve((in.size() + 2) / 3 * 4);
+  size_t i = 0;
+  for (; i + 2 < in.size(); i += 3) {
+    uint32_t n = ((unsigned char)in[i] << 16) | ((unsigned char)in[i + 1] << 8) | (unsigned char)in[i + 2];
+    out += table[(n >> 18) & 63];
+    out += table[(n >> 12) & 63];
+    out += table[(n >> 6) & 63];
+    out += table[n & 63];
+  }
+  if (i < in.size()) {
+    uint32_t n = (unsigned char)in[i] << 16;
+    if (i + 1 < in.size()) n |= (unsigned char)in[i + 1] << 8;
+    out += table[(n >> 18) & 63];
+    out += table[(n >> 12) & 63];
+    out += (i + 1 < in.size()) ? table[(n >> 6) & 63] : '=';
+    out += '=';
+  }
+  return out;
+}
+
+std::string base64Decode(const std::string &in) {
+  std::string out;
+  uint32_t buf = 0;
+  int bits = 0;
+  for (char c : in) {
+    int v;
+    if (c >= 'A' && c <= 'Z') v = c - 'A';
+    else if (c >= 'a' && c <= 'z') v = c - 'a' + 26;
+    else if (c >= '0' && c <= '9') v = c - '0' + 52;
+    else if (c == '+') v = 62;
+    else if (c == '/') v = 63;
+    else continue; // Skip padding and whitespace
+    buf = (buf << 6) | v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out += (char)((buf >> bits) & 0xFF);
+    }
+  }
+  return out;
+}
+
+std::string jsonEscape(const std::string &in) {
+  std::string out;
+  out.reserve(in.size() + 16);
+  for (unsigned char c : in) {
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (c < 0x20) {
+          char esc[8];
+          snprintf(esc, sizeof(esc), "\\u%04x", c);
+          out += esc;
+        } else {
+          out += (char)c;
+        }
+    }
+  }
+  return out;
+}
+
+// Finds "key": "value" at or after `from` and returns the unescaped value.
+// Just enough JSON for the device and chat-completion responses; not a general parser.
+bool extractJsonString(const std::string &json, const std::string &key, size_t from, std::string &out) {
+  size_t pos = json.find("\"" + key + "\"", from);
+  if (pos == std::string::npos) return false;
+  pos += key.size() + 2;
+  while (pos < json.size() && (json[pos] == ' ' || json[pos] == ':' || json[pos] == '\n' || json[pos] == '\r' || json[pos] == '\t')) pos++;
+  if (pos >= json.size() || json[pos] != '"') return false;
+  out.clear();
+  for (pos++; pos < json.size(); pos++) {
+    char c = json[pos];
+    if (c == '"') return true;
+    if (c != '\\' || pos + 1 >= json.size()) {
+      out += c;
+      continue;
+    }
+    char e = json[++pos];
+    switch (e) {
+      case 'n': out += '\n'; break;
+      case 'r': out += '\r'; break;
+      case 't': out += '\t'; break;
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'u': {
+        if (pos + 4 >= json.size()) return false;
+        unsigned cp = strtoul(json.substr(pos + 1, 4).c_str(), nullptr, 16);
+        pos += 4;
+        // Encode the BMP code point as UTF-8
+        if (cp < 0x80) {
+          out += (char)cp;
+        } else if (cp < 0x800) {
+          out += (char)(0xC0 | (cp >> 6));
+          out += (char)(0x80 | (cp & 0x3F));
+        } else {
+          out += (char)(0xE0 | (cp >> 12));
+          out += (char)(0x80 | ((cp >> 6) & 0x3F));
+          out += (char)(0x80 | (cp & 0x3F));
+        }
+        break;
+      }
+      default: out += e; // \" \\ \/
+    }
+  }
+  return false;
+}
+
+std::string toLower(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+  return s;
+}
+
+// ============ URLs and Connections ============
+struct Url {
+  bool tls = false;
+  std::string host;
+  int port = 80;
+  std::string path = "/";
+};
+
+bool parseUrl(std::string text, Url &url) {
+  if (text.find("://") == std::string::npos) text = "http://" + text; // Bare camera IPs
+  if (text.compare(0, 8, "https://") == 0) {
+    url.tls = true;
+    url.port = 443;
+    text = text.substr(8);
+  } else if (text.compare(0, 7, "http://") == 0) {
+    url.tls = false;
+    url.port = 80;
+    text = text.substr(7);
+  } else {
+    return false;
+  }
+  size_t slash = text.find('/');
+  std::string hostPort = text.substr(0, slash);
+  url.path = (slash == std::string::npos) ? "/" : text.substr(slash);
+  size_t colon = hostPort.find(':');
+  url.host = hostPort.substr(0, colon);
+  if (colon != std::string::npos) url.port = atoi(hostPort.c_str() + colon + 1);
+  return !url.host.empty() && url.port > 0;
+}
+
+#ifdef GATEWAY_TLS
+SSL_CTX *g_sslCtx = nullptr;
+#endif
+
+// Buffered socket (optionally TLS). Client side via open(), server side via adopt().
+class Connection {
+ public:
+  Connection() {}
+  ~Connection() { close(); }
+  Connection(const Connection &) = delete;
+  Connection &operator=(const Connection &) = delete;
+
+  bool open(const Url &url, int timeoutMs = 30000) {
+    close();
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(url.host.c_str(), std::to_string(url.port).c_str(), &hints, &res) != 0) return false;
+    for (addrinfo *ai = res; ai; ai = ai->ai_next) {
+      int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd < 0) continue;
+      setTimeouts(fd, timeoutMs);
+      if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+        fd_ = fd;
+        break;
+      }
+      ::close(fd);
+    }
+    freeaddrinfo(res);
+    if (fd_ < 0) return false;
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (url.tls) {
+#ifdef GATEWAY_TLS
+      ssl_ = SSL_new(g_sslCtx);
+      SSL_set_fd(ssl_, fd_);
+      SSL_set_tlsext_host_name(ssl_, url.host.c_str());
+      SSL_set1_host(ssl_, url.host.c_str());
+      if (SSL_connect(ssl_) != 1) {
+        fprintf(stderr, "TLS handshake with %s failed\n", url.host.c_str());
+        close();
+        return false;
+      }
+#else
+      fprintf(stderr, "https:// needs a build with -DGATEWAY_TLS -lssl -lcrypto\n");
+      close();
+      return false;
+#endif
+    }
+    return true;
+  }
+
+  void adopt(int fd, int timeoutMs) {
+    close();
+    fd_ = fd;
+    setTimeouts(fd_, timeoutMs);
+  }
+
+  void close() {
+#ifdef GATEWAY_TLS
+    if (ssl_) {
+      SSL_shutdown(ssl_);
+      SSL_free(ssl_);
+      ssl_ = nullptr;
+    }
+#endif
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+    buf_.clear();
+    bytesReceived_ = 0;
+    timedOut_ = false;
+  }
+
+  bool isOpen() const { return fd_ >= 0; }
+  // Total bytes read since the connection was opened
+  size_t bytesReceived() const { return bytesReceived_; }
+  // Whether the last failed read hit the receive timeout rather than EOF or a reset
+  bool timedOut() const { return timedOut_; }
+
+  bool writeAll(const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+      ssize_t n;
+#ifdef GATEWAY_TLS
+      if (ssl_) n = SSL_write(ssl_, data.data() + sent, (int)std::min<size_t>(data.size() - sent, 1 << 20));
+      else
+#endif
+        n = ::send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+      if (n <= 0) return false;
+      sent += n;
+    }
+    return true;
+  }
+
+  // Reads one line, without the trailing CRLF
+  bool readLine(std::string &line) {
+    size_t eol;
+    while ((eol = buf_.find("\r\n")) == std::string::npos) {
+      if (fill() <= 0) return false;
+    }
+    line = buf_.substr(0, eol);
+    buf_.erase(0, eol + 2);
+    return true;
+  }
+
+  bool readExact(size_t n, std::string &out) {
+    while (buf_.size() < n) {
+      if (fill() <= 0) return false;
+    }
+    out.append(buf_, 0, n);
+    buf_.erase(0, n);
+    return true;
+  }
+
+  void readToEof(std::string &out) {
+    while (fill() > 0) {}
+    out += buf_;
+    buf_.clear();
+  }
+
+ private:
+  static void setTimeouts(int fd, int timeoutMs) {
+    timeval tv{timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  }
+
+  int fill() {
+    char chunk[16384];
+    ssize_t n;
+#ifdef GATEWAY_TLS
+    if (ssl_) n = SSL_read(ssl_, chunk, sizeof(chunk));
+    else
+#endif
+      n = ::recv(fd_, chunk, sizeof(chunk), 0);
+    timedOut_ = n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    if (n > 0) {
+      buf_.append(chunk, n);
+      bytesReceived_ += n;
+    }
+    return (int)n;
+  }
+
+  int fd_ = -1;
+#ifdef GATEWAY_TLS
+  SSL *ssl_ = nullptr;
+#endif
+  std::string buf_;
+  size_t bytesReceived_ = 0;
+  bool timedOut_ = false;
+};
+
+// ============ HTTP ============
+struct HttpMessage {
+  std::string startLine;
+  std::map<std::string, std::string> headers; // Lower-case names
+  std::string body;
+
+  std::string header(const std::string &name) const {
+    auto it = headers.find(name);
+    return it == headers.end() ? "" : it->second;
+  }
+  // Status code for responses
+  int status() const {
+    size_t sp = startLine.find(' ');
+    return sp == std::string::npos ? 0 : atoi(startLine.c_str() + sp + 1);
+  }
+  // Request path for requests
+  std::string path() const {
+    size_t a = startLine.find(' ');
+    size_t b = startLine.find(' ', a + 1);
+    return a == std::string::npos ? "" : startLine.substr(a + 1, b - a - 1);
+  }
+  bool keepAlive() const { return toLower(header("connection")) != "close"; }
+};
+
+// Reads a request or response. Bodies are delimited by Content-Length, chunked
+// encoding or, for responses only, by the peer closing the connection (as the device does).
+bool readHttpMessage(Connection &conn, HttpMessage &msg, bool isResponse) {
+  msg = HttpMessage();
+  if (!conn.readLine(msg.startLine)) return false;
+  std::string line;
+  bool headerEnded = false;
+  while (conn.readLine(line)) {
+    if (line.empty()) {
+      headerEnded = true;
+      break;
+    }
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) continue;
+    size_t valueStart = line.find_first_not_of(' ', colon + 1);
+    msg.headers[toLower(line.substr(0, colon))] = valueStart == std::string::npos ? "" : line.substr(valueStart);
+  }
+  if (!headerEnded) return false; // Connection dropped inside the header
+
+  if (toLower(msg.header("transfer-encoding")).find("chunked") != std::string::npos) {
+    while (conn.readLine(line)) {
+      size_t size = strtoul(line.c_str(), nullptr, 16);
+      if (size == 0) {
+        while (conn.readLine(line) && !line.empty()) {} // Trailers
+        return true;
+      }
+      if (!conn.readExact(size, msg.body) || !conn.readLine(line)) return false;
+    }
+    return false;
+  }
+  std::string length = msg.header("content-length");
+  if (!length.empty()) return conn.readExact(strtoul(length.c_str(), nullptr, 10), msg.body);
+  if (isResponse) {
+    conn.readToEof(msg.body);
+    msg.headers["connection"] = "close";
+  }
+  return true;
+}
+
+bool writeHttpResponse(Connection &conn, int status, const std::string &contentType, const std::string &body, bool keepAlive,
+                       const std::string &extraHeaders = "") {
+  const char *reason = status == 200 ? "OK" : status == 404 ? "Not Found" : status == 429 ? "Too Many Requests" : "Error";
+  std::string out = "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n" + extraHeaders +
+                    "Content-Type: " + contentType + "\r\n"
+                    "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                    "Connection: " + (keepAlive ? "keep-alive" : "close") + "\r\n\r\n" + body;
+  return conn.writeAll(out);
+}
+
+// One-shot GET against a camera. The device serves one client at a time and closes afterwards.
+bool fetchFromDevice(const Url &base, const std::string &path, HttpMessage &resp, int timeoutMs) {
+  Connection conn;
+  if (!conn.open(base, timeoutMs)) return false;
+  std::string req = "GET " + path + " HTTP/1.1\r\nHost: " + base.host + "\r\nConnection: close\r\n\r\n";
+  return conn.writeAll(req) && readHttpMessage(conn, resp, true);
+}
+
+int listenOn(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+    fprintf(stderr, "Cannot listen on port %d: %s\n", port, strerror(errno));
+    exit(1);
+  }
+  return fd;
+}
+
+// ============ Metrics ============
+
+// Keeps the most recent samples in a ring and reports percentiles over them
+class LatencyStats {
+ public:
+  void add(double ms) {
+    std::lock_guard<std::mutex> lock(mu_);
+    samples_[next_] = ms;
+    next_ = (next_ + 1) % samples_.size();
+    if (count_ < samples_.size()) count_++;
+  }
+
+  std::string toJson() {
+    std::vector<double> sorted;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      sorted.assign(samples_.begin(), samples_.begin() + count_);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    auto pct = [&](double p) { return sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))]; };
+    char out[160];
+    snprintf(out, sizeof(out), "{\"samples\":%zu,\"p50\":%.1f,\"p95\":%.1f,\"p99\":%.1f,\"max\":%.1f}",
+             sorted.size(), pct(0.50), pct(0.95), pct(0.99), sorted.empty() ? 0.0 : sorted.back());
+    return out;
+  }
+
+ private:
+  std::mutex mu_;
+  std::vector<double> samples_ = std::vector<double>(2048);
+  size_t next_ = 0;
+  size_t count_ = 0;
+};
+
+struct Metrics {
+  std::atomic<uint64_t> framesPolled{0};
+  std::atomic<uint64_t> pollErrors{0};
+  std::atomic<uint64_t> duplicatesDropped{0};
+  std::atomic<uint64_t> jobsEnqueued{0};
+  std::atomic<uint64_t> jobsMerged{0};
+  std::atomic<uint64_t> upstreamCalls{0};
+  std::atomic<uint64_t> upstreamErrors{0};
+  std::atomic<uint64_t> connectionsOpened{0};
+  std::atomic<uint64_t> connectionReuses{0};  // Responses received on an already open connection
+  std::atomic<uint64_t> staleRetries{0};      // Reused connection found closed, request resent
+  std::atomic<uint64_t> rateLimited{0};       // 429 responses
+  std::atomic<uint64_t> upstreamRetries{0};   // Failed jobs put back into the scheduler
+  std::atomic<uint64_t> recovered{0};         // Jobs analysed after at least one failed attempt
+  std::atomic<uint64_t> forcedRefreshes{0};   // Enqueued by --max-skip-ms despite looking unchanged
+  LatencyStats queueWait;  // Enqueued -> sent upstream
+  LatencyStats upstream;   // Upstream round trip
+  LatencyStats endToEnd;   // Oldest unanalysed change captured -> analysis stored
+};
+
+Metrics g_metrics;
+
+// ============ Cameras and Jobs ============
+struct Camera {
+  size_t index = 0;
+  std::string baseUrl;
+  Url url;
+  std::string promptType = "formal";
+  int weight = 2;
+
+  // Last frame handed to the scheduler, only touched by this camera's poller. New frames are
+  // compared against it, so slow drift still adds up to a detected change. Retryable analysis
+  // failures are requeued by the pool, so moving it forward on enqueue does not drop a change.
+  std::string prevFrame;
+  Clock::time_point lastEnqueuedAt;
+
+  std::atomic<uint64_t> frames{0};
+  std::atomic<uint64_t> duplicates{0};
+  std::atomic<uint64_t> analyses{0};
+  std::atomic<uint64_t> errors{0};
+
+  std::mutex resultMu;
+  std::string lastResult;
+  bool lastOk = false;
+  double lastLatencyMs = 0;
+};
+
+std::vector<std::unique_ptr<Camera>> g_cameras;
+
+// Alert cameras are scheduled ahead of formal ones, formal ahead of friendly
+int weightFor(const std::string &promptType) {
+  if (promptType == "alert") return 4;
+  if (promptType == "formal") return 2;
+  return 1;
+}
+
+std::string promptFor(const std::string &promptType) {
+  std::string prompt;
+  if (promptType == "alert") {
+    prompt = "URGENT ALERT: Immediate action required. Analyze and identify critical changes between the two images that demand immediate attention. Focus on potential threats, security breaches, or critical system failures. Respond with a very concise, actionable alert message.";
+  } else if (promptType == "friendly") {
+    prompt = "Hey there! I've taken two pictures of your room a little while apart. Could you tell me in a friendly, easy-to-understand way if anything looks different? Like, did someone move something, or is a light on that wasn't before? Just a quick summary for a home user, please!";
+  } else {
+    prompt = "Generate a comprehensive, formal analytical report comparing the two provided images. Detail all observed changes, including subtle differences in lighting, object positions, and the operational status of any visible devices. Analyze potential causes and implications of these changes. Present findings in a structured, objective manner.";
+  }
+  return prompt + base_analysis_prompt;
+}
+
+struct Job {
+  size_t camera = 0;
+  std::string img1; // Raw JPEG
+  std::string img2;
+  int weight = 1;
+  int attempts = 0; // Failed upstream attempts so far
+  Clock::time_point capturedAt;
+  Clock::time_point enqueuedAt;
+  Clock::time_point notBefore; // Retry backoff
+};
+
+// ============ Fair Scheduler ============
+
+// Holds at most one pending job per camera. A newer pair from the same camera is merged
+// into the pending one (oldest first frame, newest second frame, original wait time), so a
+// slow upstream never builds a backlog of stale frames yet no detected change is lost.
+// Jobs are picked by weight * time waited, which favours alert cameras while still
+// guaranteeing every waiting camera is eventually served.
+class FairScheduler {
+ public:
+  explicit FairScheduler(size_t cameras) : pending_(cameras) {}
+
+  // Returns true if the job was merged into one already pending for the camera
+  bool push(Job job) {
+    bool merged;
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      std::optional<Job> &slot = pending_[job.camera];
+      merged = slot.has_value();
+      if (merged) {
+        job.img1 = std::move(slot->img1);
+        job.capturedAt = slot->capturedAt;
+        job.enqueuedAt = slot->enqueuedAt;
+        job.attempts = slot->attempts;
+        job.notBefore = slot->notBefore;
+      }
+      slot = std::move(job);
+    }
+    cv_.notify_one();
+    return merged;
+  }
+
+  // Puts back a job whose analysis failed, not to be picked before notBefore. If the camera
+  // queued a newer job meanwhile, the failed job's older first frame and wait time carry over.
+  void requeue(Job job, Clock::time_point notBefore) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      std::optional<Job> &slot = pending_[job.camera];
+      job.notBefore = notBefore;
+      if (slot) job.img2 = std::move(slot->img2);
+      slot = std::move(job);
+    }
+    cv_.notify_all();
+  }
+
+  // Stops handing out any job before `until`, e.g. while the upstream is rate limiting
+  void holdUntil(Clock::time_point until) {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      holdUntil_ = std::max(holdUntil_, until);
+    }
+    cv_.notify_all();
+  }
+
+  // Blocks until a job is due and returns the highest ranked one; nullopt after shutdown()
+  std::optional<Job> pop() {
+    std::unique_lock<std::mutex> lock(mu_);
+    while (!stopped_) {
+      auto now = Clock::now();
+      auto wakeAt = Clock::time_point::max();
+      size_t best = pending_.size();
+      double bestScore = -1;
+      if (now < holdUntil_) {
+        wakeAt = holdUntil_;
+      } else {
+        for (size_t i = 0; i < pending_.size(); i++) {
+          if (!pending_[i]) continue;
+          if (pending_[i]->notBefore > now) {
+            wakeAt = std::min(wakeAt, pending_[i]->notBefore);
+            continue;
+          }
+          double score = pending_[i]->weight * (msBetween(pending_[i]->enqueuedAt, now) + 1.0);
+          if (score > bestScore) {
+            bestScore = score;
+            best = i;
+          }
+        }
+      }
+      if (best < pending_.size()) {
+        std::optional<Job> job = std::move(pending_[best]);
+        pending_[best].reset();
+        return job;
+      }
+      if (wakeAt == Clock::time_point::max()) cv_.wait(lock);
+      else cv_.wait_until(lock, wakeAt);
+    }
+    return std::nullopt;
+  }
+
+  void shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stopped_ = true;
+    }
+    cv_.notify_all();
+  }
+
+ private:
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::vector<std::optional<Job>> pending_;
+  Clock::time_point holdUntil_;
+  bool stopped_ = false;
+};
+
+// ============ Upstream Pool ============
+
+// Same payload shape as sendToAPI() on the device, with the prompt properly escaped
+std::string buildPayload(const Camera &cam, const Job &job) {
+  return "{"
+         "\"model\":\"" + jsonEscape(g_config.model) + "\","
+         "\"messages\":["
+         "{\"role\":\"system\",\"content\":\"" + jsonEscape(system_prompt) + "\"},"
+         "{\"role\":\"user\",\"content\":["
+         "{\"type\":\"text\",\"text\":\"" + jsonEscape(promptFor(cam.promptType)) + "\"},"
+         "{\"type\":\"image_url\",\"image_url\":{\"url\":\"data:image/jpeg;base64," + base64Encode(job.img1) + "\"}},"
+         "{\"type\":\"image_url\",\"image_url\":{\"url\":\"data:image/jpeg;base64," + base64Encode(job.img2) + "\"}}"
+         "]}"
+         "]"
+         "}";
+}
+
+// A fixed set of workers, each owning one keep-alive connection to the upstream.
+// A worker takes the next best job from the scheduler as soon as it is free, so at
+// most `size` requests are in flight and a slow response never idles the others.
+class UpstreamPool {
+ public:
+  UpstreamPool(const Url &url, size_t size, FairScheduler &scheduler) : url_(url), scheduler_(scheduler) {
+    for (size_t i = 0; i < size; i++) std::thread([this] { workerLoop(); }).detach();
+  }
+
+ private:
+  void workerLoop() {
+    Connection conn;
+    while (std::optional<Job> job = scheduler_.pop()) processJob(conn, *job);
+  }
+
+  // POSTs over the worker's connection, reconnecting once if a reused connection went stale
+  bool post(Connection &conn, const std::string &payload, HttpMessage &resp) {
+    std::string req = "POST " + url_.path + " HTTP/1.1\r\n"
+                      "Host: " + url_.host + "\r\n"
+                      "Content-Type: application/json\r\n"
+                      "Authorization: Bearer " + g_config.apiKey + "\r\n"
+                      "Content-Length: " + std::to_string(payload.size()) + "\r\n"
+                      "Connection: keep-alive\r\n\r\n" + payload;
+    for (int attempt = 0; attempt < 2; attempt++) {
+      bool reused = conn.isOpen();
+      if (!reused) {
+        if (!conn.open(url_)) return false;
+        g_metrics.connectionsOpened++;
+      }
+      size_t receivedBefore = conn.bytesReceived();
+      if (conn.writeAll(req) && readHttpMessage(conn, resp, true)) {
+        if (reused) g_metrics.connectionReuses++;
+        if (!resp.keepAlive()) conn.close();
+        return true;
+      }
+      // Only retry when the peer had already dropped the idle connection (reset or EOF before
+      // any response byte). After a timeout the request may still be processed and billed.
+      bool stale = reused && conn.bytesReceived() == receivedBefore && !conn.timedOut();
+      conn.close();
+      if (!stale) return false;
+      g_metrics.staleRetries++;
+    }
+    return false;
+  }
+
+  void processJob(Connection &conn, Job &job) {
+    Camera &cam = *g_cameras[job.camera];
+    auto sentAt = Clock::now();
+    g_metrics.queueWait.add(msBetween(job.enqueuedAt, sentAt));
+    g_metrics.upstreamCalls++;
+
+    HttpMessage resp;
+    bool sent = post(conn, buildPayload(cam, job), resp);
+    auto doneAt = Clock::now();
+    g_metrics.upstream.add(msBetween(sentAt, doneAt));
+
+    std::string result;
+    bool ok = false;
+    if (!sent) {
+      result = "Error: upstream request failed";
+    } else {
+      size_t message = resp.body.find("\"message\"");
+      ok = resp.status() == 200 && message != std::string::npos && extractJsonString(resp.body, "content", message, result);
+      if (!ok) result = "Error: HTTP " + std::to_string(resp.status()) + ": " + resp.body.substr(0, 300);
+    }
+    if (ok) {
+      cam.analyses++;
+      if (job.attempts > 0) g_metrics.recovered++;
+      g_metrics.endToEnd.add(msBetween(job.capturedAt, doneAt));
+    } else {
+      cam.errors++;
+      g_metrics.upstreamErrors++;
+      fprintf(stderr, "[cam %zu] %s\n", cam.index, result.c_str());
+      // Transport errors, timeouts, rate limits and server errors are worth retrying; any other
+      // status means the request itself is wrong and retrying would fail the same way.
+      int status = sent ? resp.status() : 0;
+      if (status == 0 || status == 408 || status == 429 || status >= 500) retryLater(job, resp, status);
+    }
+    std::lock_guard<std::mutex> lock(cam.resultMu);
+    cam.lastResult = result;
+    cam.lastOk = ok;
+    cam.lastLatencyMs = msBetween(job.capturedAt, doneAt);
+  }
+
+  // Requeues a failed job with exponential backoff (1 s doubling to 64 s). A 429 pauses
+  // every worker, since the rate limit applies to the whole fleet's API key.
+  void retryLater(Job &job, const HttpMessage &resp, int status) {
+    job.attempts++;
+    auto delay = std::chrono::seconds(1 << std::min(job.attempts - 1, 6));
+    if (status == 429) {
+      g_metrics.rateLimited++;
+      int retryAfter = atoi(resp.header("retry-after").c_str());
+      delay = std::max(delay, std::chrono::seconds(retryAfter));
+      scheduler_.holdUntil(Clock::now() + delay);
+    }
+    g_metrics.upstreamRetries++;
+    scheduler_.requeue(std::move(job), Clock::now() + delay);
+  }
+
+  Url url_;
+  FairScheduler &scheduler_;
+};
+
+// ============ Camera Pollers ============
+
+// Fetches the newest frame from a camera; false on network or device errors
+bool pollOnce(Camera &cam, std::string &frame) {
+  HttpMessage resp;
+  if (g_config.mode == "json") {
+    // Existing firmware: blocks for the delay, returns both images Base64-encoded in JSON.
+    // Only the second image is compared with the last frame analysed; the first just
+    // seeds that baseline, as a change between polls would otherwise appear in both.
+    int timeoutMs = (g_config.captureDelay + 30) * 1000;
+    std::string path = "/capture_images?delay=" + std::to_string(g_config.captureDelay);
+    if (!fetchFromDevice(cam.url, path, resp, timeoutMs) || resp.status() != 200) return false;
+    std::string b64a, b64b;
+    if (resp.body.find("\"success\":true") == std::string::npos ||
+        !extractJsonString(resp.body, "img1_base64", 0, b64a) || !extractJsonString(resp.body, "img2_base64", 0, b64b)) {
+      return false;
+    }
+    HttpMessage reset;
+    fetchFromDevice(cam.url, "/reset_data", reset, 5000); // Free the device's Base64 buffers
+    if (cam.prevFrame.empty()) cam.prevFrame = base64Decode(b64a);
+    frame = base64Decode(b64b);
+    cam.frames += 2;
+    g_metrics.framesPolled += 2;
+    return true;
+  }
+
+  // Lighter /capture_frame endpoint: one raw JPEG per poll
+  if (!fetchFromDevice(cam.url, "/capture_frame", resp, 10000) || resp.status() != 200 || resp.body.empty()) return false;
+  cam.frames++;
+  g_metrics.framesPolled++;
+  frame = std::move(resp.body);
+  return true;
+}
+
+void pollCamera(Camera &cam, FairScheduler &scheduler) {
+  // Size-based dedup never applies to alert cameras; they only skip byte-identical frames
+  int dedupPercent = cam.promptType == "alert" ? 0 : g_config.dedupPercent;
+  while (g_running) {
+    auto started = Clock::now();
+    std::string frame;
+    if (!pollOnce(cam, frame)) {
+      g_metrics.pollErrors++;
+      fprintf(stderr, "[cam %zu] poll of %s failed\n", cam.index, cam.baseUrl.c_str());
+    } else {
+      auto capturedAt = Clock::now();
+      bool overdue = g_config.maxSkipMs > 0 && msBetween(cam.lastEnqueuedAt, capturedAt) >= g_config.maxSkipMs;
+      if (cam.prevFrame.empty()) {
+        // First frame from this camera, nothing to compare against yet
+        cam.prevFrame = std::move(frame);
+        cam.lastEnqueuedAt = capturedAt;
+      } else if (!overdue && framesSimilar(cam.prevFrame, frame, dedupPercent)) {
+        cam.duplicates++;
+        g_metrics.duplicatesDropped++;
+      } else {
+        if (overdue && framesSimilar(cam.prevFrame, frame, dedupPercent)) g_metrics.forcedRefreshes++;
+        Job job;
+        job.camera = cam.index;
+        job.img1 = std::move(cam.prevFrame);
+        job.img2 = frame;
+        job.weight = cam.weight;
+        job.capturedAt = capturedAt;
+        job.enqueuedAt = Clock::now();
+        cam.prevFrame = std::move(frame);
+        cam.lastEnqueuedAt = capturedAt;
+        g_metrics.jobsEnqueued++;
+        if (scheduler.push(std::move(job))) g_metrics.jobsMerged++;
+      }
+    }
+    std::this_thread::sleep_until(started + std::chrono::milliseconds(g_config.pollMs));
+  }
+}
+
+// ============ Gateway HTTP Endpoints ============
+std::string metricsJson() {
+  double uptime = msBetween(g_startTime, Clock::now()) / 1000.0;
+  uint64_t analyses = 0;
+  std::string perCamera;
+  for (auto &cam : g_cameras) {
+    analyses += cam->analyses;
+    perCamera += std::string(perCamera.empty() ? "" : ",") +
+                 "{\"id\":" + std::to_string(cam->index) + ",\"url\":\"" + jsonEscape(cam->baseUrl) + "\",\"type\":\"" + cam->promptType +
+                 "\",\"frames\":" + std::to_string(cam->frames) + ",\"duplicates\":" + std::to_string(cam->duplicates) +
+                 ",\"analyses\":" + std::to_string(cam->analyses) + ",\"errors\":" + std::to_string(cam->errors) + "}";
+  }
+  char head[1024];
+  snprintf(head, sizeof(head),
+           "{\"uptime_s\":%.1f,\"cameras\":%zu,\"frames_polled\":%lu,\"poll_errors\":%lu,\"duplicates_dropped\":%lu,"
+           "\"jobs_enqueued\":%lu,\"jobs_merged\":%lu,"
+           "\"upstream_calls\":%lu,\"upstream_errors\":%lu,\"upstream_retries\":%lu,\"rate_limited\":%lu,\"recovered\":%lu,"
+           "\"connections_opened\":%lu,\"connection_reuses\":%lu,\"stale_retries\":%lu,\"forced_refreshes\":%lu,"
+           "\"analyses\":%lu,\"analyses_per_min\":%.2f,",
+           uptime, g_cameras.size(), (unsigned long)g_metrics.framesPolled, (unsigned long)g_metrics.pollErrors,
+           (unsigned long)g_metrics.duplicatesDropped, (unsigned long)g_metrics.jobsEnqueued, (unsigned long)g_metrics.jobsMerged,
+           (unsigned long)g_metrics.upstreamCalls, (unsigned long)g_metrics.upstreamErrors, (unsigned long)g_metrics.upstreamRetries,
+           (unsigned long)g_metrics.rateLimited, (unsigned long)g_metrics.recovered,
+           (unsigned long)g_metrics.connectionsOpened, (unsigned long)g_metrics.connectionReuses,
+           (unsigned long)g_metrics.staleRetries, (unsigned long)g_metrics.forcedRefreshes,
+           (unsigned long)analyses, uptime > 0 ? analyses * 60.0 / uptime : 0.0);
+  return std::string(head) +
+         "\"latency_ms\":{\"queue_wait\":" + g_metrics.queueWait.toJson() +
+         ",\"upstream\":" + g_metrics.upstream.toJson() +
+         ",\"end_to_end\":" + g_metrics.endToEnd.toJson() + "},"
+         "\"per_camera\":[" + perCamera + "]}";
+}
+
+std::string analysesJson() {
+  std::string out = "[";
+  for (auto &cam : g_cameras) {
+    std::lock_guard<std::mutex> lock(cam->resultMu);
+    char latency[32];
+    snprintf(latency, sizeof(latency), "%.1f", cam->lastLatencyMs);
+    out += std::string(out.size() > 1 ? "," : "") +
+           "{\"id\":" + std::to_string(cam->index) + ",\"url\":\"" + jsonEscape(cam->baseUrl) + "\",\"type\":\"" + cam->promptType +
+           "\",\"ok\":" + (cam->lastOk ? "true" : "false") + ",\"latency_ms\":" + latency +
+           ",\"content\":\"" + jsonEscape(cam->lastResult) + "\"}";
+  }
+  return out + "]";
+}
+
+void serveGateway(int listenFd) {
+  while (true) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0) continue;
+    Connection conn;
+    conn.adopt(fd, 5000);
+    HttpMessage req;
+    if (!readHttpMessage(conn, req, false)) continue;
+    std::string path = req.path();
+    if (path == "/metrics") writeHttpResponse(conn, 200, "application/json", metricsJson(), false);
+    else if (path == "/analyses") writeHttpResponse(conn, 200, "application/json", analysesJson(), false);
+    else writeHttpResponse(conn, 404, "text/plain", "Endpoints: /metrics, /analyses\n", false);
+  }
+}
+
+// ============ Simulation ============
+
+// Stand-in for an ESP32-CAM: serves /capture_frame, /capture_images and /reset_data like the
+// firmware, one client at a time. Like a real sensor no two frames are byte-identical: a static
+// scene only jitters the JPEG size by up to 0.5%, while about one capture in three changes the
+// scene and moves the size by 8-30%.
+void runSimulatedCamera(int port, unsigned seed) {
+  int listenFd = listenOn(port);
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  double sceneSize = 2048;
+  auto nextFrame = [&]() {
+    if (rng() % 3 == 0) {
+      double change = 0.08 + 0.22 * unit(rng);
+      bool grow = rng() % 2;
+      if (sceneSize * (1 + change) > 8192) grow = false; // Turn around at the bounds so every change counts
+      if (sceneSize * (1 - change) < 1024) grow = true;
+      sceneSize *= grow ? 1 + change : 1 - change;
+    }
+    size_t size = (size_t)(sceneSize * (1.0 + 0.01 * (unit(rng) - 0.5)));
+    std::string frame = "\xFF\xD8\xFF\xE0"; // JPEG SOI + APP0
+    for (size_t i = 0; i < size; i++) frame += (char)(rng() & 0xFF);
+    frame += "\xFF\xD9";
+    return frame;
+  };
+
+  while (true) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0) continue;
+    Connection conn;
+    conn.adopt(fd, 5000);
+    HttpMessage req;
+    if (!readHttpMessage(conn, req, false)) continue;
+    std::string path = req.path();
+    if (path == "/capture_frame") {
+      writeHttpResponse(conn, 200, "image/jpeg", nextFrame(), false);
+    } else if (path.compare(0, 15, "/capture_images") == 0) {
+      int delaySeconds = 5;
+      size_t pos = path.find("delay=");
+      if (pos != std::string::npos) delaySeconds = std::clamp(atoi(path.c_str() + pos + 6), 1, 60);
+      std::string img1 = base64Encode(nextFrame());
+      std::this_thread::sleep_for(std::chrono::seconds(delaySeconds));
+      std::string img2 = base64Encode(nextFrame());
+      writeHttpResponse(conn, 200, "application/json",
+                        "{\"success\":true, \"message\":\"Images captured successfully\", \"img1_base64\":\"" + img1 +
+                        "\", \"img2_base64\":\"" + img2 + "\"}", false);
+    } else if (path == "/reset_data") {
+      writeHttpResponse(conn, 200, "application/json", "{\"success\":true, \"message\":\"Data reset successfully\"}", false);
+    } else {
+      writeHttpResponse(conn, 404, "text/plain", "Not found\n", false);
+    }
+  }
+}
+
+// Local chat-completions endpoint with keep-alive support and a fixed response delay.
+// With --mock-fail every Nth request gets a 500, a 429 (Retry-After: 1), or a normal
+// response followed by closing the connection the client expects to keep open.
+void runMockLlm(int port, int latencyMs) {
+  int listenFd = listenOn(port);
+  std::atomic<uint64_t> requests{0};
+  while (true) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0) continue;
+    std::thread([fd, latencyMs, &requests] {
+      Connection conn;
+      conn.adopt(fd, 60000);
+      HttpMessage req;
+      while (readHttpMessage(conn, req, false)) {
+        uint64_t n = ++requests;
+        std::this_thread::sleep_for(std::chrono::milliseconds(latencyMs));
+        bool fail = !g_config.mockFail.empty() && n % g_config.mockFailEvery == 0;
+        if (fail && g_config.mockFail == "500") {
+          if (!writeHttpResponse(conn, 500, "application/json", "{\"error\":{\"message\":\"mock server error\"}}", req.keepAlive())) break;
+          continue;
+        }
+        if (fail && g_config.mockFail == "429") {
+          if (!writeHttpResponse(conn, 429, "application/json", "{\"error\":{\"message\":\"mock rate limit\"}}", req.keepAlive(),
+                                 "Retry-After: 1\r\n")) break;
+          continue;
+        }
+        std::string content = "Mock analysis #" + std::to_string(n) + ": the second image differs slightly in lighting.";
+        std::string body = "{\"id\":\"mock-" + std::to_string(n) + "\",\"object\":\"chat.completion\",\"choices\":[{\"index\":0,"
+                           "\"message\":{\"role\":\"assistant\",\"content\":\"" + jsonEscape(content) + "\"},\"finish_reason\":\"stop\"}]}";
+        if (!writeHttpResponse(conn, 200, "application/json", body, req.keepAlive()) || !req.keepAlive()) break;
+        if (fail && g_config.mockFail == "close") break; // Drop the connection as an idle timeout would
+      }
+    }).detach();
+  }
+}
+
+// ============ Setup ============
+void printUsage() {
+  fprintf(stderr,
+          "Usage: gateway [options]\n"
+          "  --camera URL[,alert|formal|friendly]  camera to poll (repeatable)\n"
+          "  --mode frame|json        /capture_frame (default) or legacy /capture_images\n"
+          "  --poll-ms N              poll interval per camera (default 5000)\n"
+          "  --capture-delay S        delay passed to /capture_images in json mode (default 1)\n"
+          "  --upstream URL           chat-completions endpoint (default Avalapis)\n"
+          "  --api-key KEY            API key (default $GATEWAY_API_KEY)\n"
+          "  --model NAME             model name (default gemini-1.5-flash)\n"
+          "  --connections N          pooled upstream connections / max requests in flight (default 4)\n"
+          "  --dedup-percent N        JPEG size change treated as noise for formal/friendly\n"
+          "                           cameras, 0 = exact only (default 0)\n"
+          "  --max-skip-ms N          analyse anyway after N ms without analysis, 0 = never (default 60000)\n"
+          "  --listen PORT            port for /metrics and /analyses (default 8080)\n"
+          "  --simulate N             start N simulated cameras on 127.0.0.1\n"
+          "  --sim-base-port P        first simulated camera port (default 18100)\n"
+          "  --mock-llm PORT          start a local mock LLM and use it as upstream\n"
+          "  --mock-latency-ms N      mock LLM response delay (default 300)\n"
+          "  --mock-fail 500|429|close  fault injected by the mock LLM on every Nth request\n"
+          "  --mock-fail-every N      (default 3)\n"
+          "  --duration S             exit after S seconds and print metrics\n");
+}
+
+bool parseArgs(int argc, char **argv) {
+  const char *envKey = getenv("GATEWAY_API_KEY");
+  if (envKey) g_config.apiKey = envKey;
+  bool upstreamGiven = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) return false;
+    std::string value = argv[++i];
+    if (arg == "--camera") g_config.cameras.push_back(value);
+    else if (arg == "--mode") g_config.mode = value;
+    else if (arg == "--poll-ms") g_config.pollMs = std::max(100, atoi(value.c_str()));
+    else if (arg == "--capture-delay") g_config.captureDelay = std::clamp(atoi(value.c_str()), 1, 60);
+    else if (arg == "--upstream") { g_config.upstream = value; upstreamGiven = true; }
+    else if (arg == "--api-key") g_config.apiKey = value;
+    else if (arg == "--model") g_config.model = value;
+    else if (arg == "--connections") g_config.connections = std::max(1, atoi(value.c_str()));
+    else if (arg == "--dedup-percent") g_config.dedupPercent = std::clamp(atoi(value.c_str()), 0, 100);
+    else if (arg == "--max-skip-ms") g_config.maxSkipMs = std::max(0, atoi(value.c_str()));
+    else if (arg == "--listen") g_config.listenPort = atoi(value.c_str());
+    else if (arg == "--simulate") g_config.simulate = std::max(0, atoi(value.c_str()));
+    else if (arg == "--sim-base-port") g_config.simBasePort = atoi(value.c_str());
+    else if (arg == "--mock-llm") g_config.mockLlmPort = atoi(value.c_str());
+    else if (arg == "--mock-latency-ms") g_config.mockLatencyMs = std::max(0, atoi(value.c_str()));
+    else if (arg == "--mock-fail") g_config.mockFail = value;
+    else if (arg == "--mock-fail-every") g_config.mockFailEvery = std::max(1, atoi(value.c_str()));
+    else if (arg == "--duration") g_config.durationSec = std::max(0, atoi(value.c_str()));
+    else return false;
+  }
+  if (g_config.mode != "frame" && g_config.mode != "json") return false;
+  if (!g_config.mockFail.empty() && g_config.mockFail != "500" && g_config.mockFail != "429" && g_config.mockFail != "close") return false;
+  if (g_config.mockLlmPort && !upstreamGiven) {
+    g_config.upstream = "http://127.0.0.1:" + std::to_string(g_config.mockLlmPort) + "/v1/chat/completions";
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (!parseArgs(argc, argv)) {
+    printUsage();
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, [](int) { g_running = false; });
+  signal(SIGTERM, [](int) { g_running = false; });
+
+#ifdef GATEWAY_TLS
+  SSL_library_init();
+  g_sslCtx = SSL_CTX_new(TLS_client_method());
+  SSL_CTX_set_default_verify_paths(g_sslCtx);
+  SSL_CTX_set_verify(g_sslCtx, SSL_VERIFY_PEER, nullptr);
+#endif
+
+  // Simulated nodes and mock LLM come up first so the gateway can reach them immediately
+  const char *simTypes[] = {"alert", "formal", "friendly"};
+  for (int i = 0; i < g_config.simulate; i++) {
+    int port = g_config.simBasePort + i;
+    std::thread(runSimulatedCamera, port, 1000u + i).detach();
+    g_config.cameras.push_back("http://127.0.0.1:" + std::to_string(port) + "," + simTypes[i % 3]);
+  }
+  if (g_config.mockLlmPort) std::thread(runMockLlm, g_config.mockLlmPort, g_config.mockLatencyMs).detach();
+
+  for (const std::string &spec : g_config.cameras) {
+    auto cam = std::make_unique<Camera>();
+    size_t comma = spec.find(',');
+    cam->baseUrl = spec.substr(0, comma);
+    if (comma != std::string::npos) cam->promptType = spec.substr(comma + 1);
+    if (cam->promptType != "alert" && cam->promptType != "formal" && cam->promptType != "friendly") {
+      fprintf(stderr, "Invalid prompt type for %s: '%s' (expected alert, formal or friendly)\n", cam->baseUrl.c_str(), cam->promptType.c_str());
+      return 1;
+    }
+    if (!parseUrl(cam->baseUrl, cam->url)) {
+      fprintf(stderr, "Invalid camera URL: %s\n", cam->baseUrl.c_str());
+      return 1;
+    }
+    cam->weight = weightFor(cam->promptType);
+    cam->index = g_cameras.size();
+    g_cameras.push_back(std::move(cam));
+  }
+  Url upstreamUrl;
+  if (g_cameras.empty() || !parseUrl(g_config.upstream, upstreamUrl)) {
+    printUsage();
+    return 1;
+  }
+  if (g_config.apiKey.empty() && !g_config.mockLlmPort) fprintf(stderr, "Warning: no API key set (--api-key or GATEWAY_API_KEY)\n");
+
+  FairScheduler scheduler(g_cameras.size());
+  UpstreamPool pool(upstreamUrl, g_config.connections, scheduler);
+  std::thread(serveGateway, listenOn(g_config.listenPort)).detach();
+  for (auto &cam : g_cameras) std::thread(pollCamera, std::ref(*cam), std::ref(scheduler)).detach();
+
+  fprintf(stderr, "Gateway polling %zu camera(s) in %s mode, upstream %s, metrics on :%d/metrics\n",
+          g_cameras.size(), g_config.mode.c_str(), g_config.upstream.c_str(), g_config.listenPort);
+
+  auto stopAt = g_startTime + std::chrono::seconds(g_config.durationSec);
+  while (g_running && (g_config.durationSec == 0 || Clock::now() < stopAt)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  }
+  g_running = false;
+  scheduler.shutdown();
+
+  printf("%s\n", metricsJson().c_str());
+  fflush(stdout);
+  // Pollers and pool workers may be blocked in sockets; exit without joining them
+  _exit(0);
+}